@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# usage: genqueries.sh REFERENCE LENGTH COUNT
+# cuts COUNT fixed length queries at random positions out of REFERENCE
+
+REFERENCE=$1
+LENGTH=${2:-100}
+COUNT=${3:-1000}
+
+awk -v len="$LENGTH" -v count="$COUNT" '
+NR > 1 { seq = seq $0 }
+END {
+	if (length(seq) < len) {
+		print "reference is shorter than " len > "/dev/stderr"
+		exit 1
+	}
+	srand(1)
+	for (i = 0; i < count; i++) {
+		pos = int(rand() * (length(seq) - len + 1))
+		print ">" i ":" pos
+		print substr(seq, pos + 1, len)
+	}
+}' "$REFERENCE"
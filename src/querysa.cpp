@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include <cereal/archives/binary.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/types/unordered_map.hpp>
@@ -27,7 +29,11 @@ static char args_doc[] = "INDEX QUERYFILE QUERYMODE OUTPUT";
 
 /* The options we understand. */
 static struct argp_option options[] = {
-    {0, 'b', "benchmarking_file", 0, "Path to benchmarking file"}, {0}};
+    {0, 'b', "benchmarking_file", 0, "Path to benchmarking file"},
+    {"fixed", 'f', 0, 0,
+     "Use kernels specialized for the batch's query length (32, 64, 100 or "
+     "150) when all queries share it"},
+    {0}};
 
 /* Used by main to communicate with parse_opt. */
 struct arguments {
@@ -36,6 +42,7 @@ struct arguments {
   char *query_mode;
   char *output;
   char *benchmarking_file;
+  bool fixed;
 };
 
 /* Parse a single option. */
@@ -47,6 +54,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   switch (key) {
     case 'b':
       arguments->benchmarking_file = arg;
+      break;
+    case 'f':
+      arguments->fixed = true;
+      break;
     case ARGP_KEY_ARG:
       if (state->arg_num >= 4) /* Too many arguments. */
         argp_usage(state);
@@ -76,53 +87,105 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
-int lcp(std::string const &s1, std::string const &s2) {
-  if (s1.length() > s2.length()) {
-    return lcp(s2, s1);
+/* Our argp parser. */
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+// number of leading characters of query matching text, comparing 8 at a
+// time. The first minlcp characters are already known to match and n bounds
+// the comparison.
+inline std::size_t wordmatch(const char *text, const char *query,
+                             std::size_t minlcp, std::size_t n) {
+  std::size_t i = minlcp;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; i + 8 <= n; i += 8) {
+    uint64_t q, t;
+    std::memcpy(&q, query + i, 8);
+    std::memcpy(&t, text + i, 8);
+    if (q != t) {
+      // lowest differing byte is the first mismatching character
+      return i + __builtin_ctzll(q ^ t) / 8;
+    }
   }
-  // s1 guaranteed smaller now
-  int prefix = 0;
-  for (uint i = 0; i < s1.length(); i++) {
-    if (s1.at(i) != s2.at(i)) {
-      return prefix;
+#endif
+  for (; i < n && query[i] == text[i]; i++) {
+  }
+  return i;
+}
+
+// same as wordmatch over exactly LEN characters. The trip counts are
+// constants, so the compiler can unroll the LEN / 8 word compares.
+template <std::size_t LEN>
+inline std::size_t fixedmatch(const char *text, const char *query) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (std::size_t w = 0; w < LEN / 8; w++) {
+    uint64_t q, t;
+    std::memcpy(&q, query + w * 8, 8);
+    std::memcpy(&t, text + w * 8, 8);
+    if (q != t) {
+      return w * 8 + __builtin_ctzll(q ^ t) / 8;
+    }
+  }
+  for (std::size_t i = LEN / 8 * 8; i < LEN; i++) {
+    if (query[i] != text[i]) {
+      return i;
     }
-    prefix++;
   }
-  return prefix;
+  return LEN;
+#else
+  return wordmatch(text, query, 0, LEN);
+#endif
 }
 
-/* Our argp parser. */
-static struct argp argp = {options, parse_opt, args_doc, doc};
+// lcp of query with the suffix of seq starting at seqidx. LEN == 0 is the
+// generic path for queries whose length is only known at runtime; otherwise
+// query is LEN long and only suffixes near the end of seq take that path.
+template <std::size_t LEN>
+inline std::size_t matchlength(const std::string &seq, int seqidx,
+                               const std::string &query, int minlcp) {
+  const char *text = seq.data() + seqidx;
+  std::size_t remaining = seq.length() - (std::size_t)seqidx;
+  if constexpr (LEN != 0) {
+    if (remaining >= LEN) {
+      return fixedmatch<LEN>(text, query.data());
+    }
+  }
+  return wordmatch(text, query.data(), minlcp,
+                   std::min(query.length(), remaining));
+}
 
 // not only does this do a comparison, it will return the lcp length of query
 // with seq at (seqidx + minlcp)
-int lcpcompare(const std::string &seq, int seqidx, const std::string &query,
-               int minlcp) {
-  std::string segment = seq.substr(seqidx, query.length() - minlcp);
-  int lcp = minlcp;
-  for (uint i = (uint)minlcp;
-       i < query.length() && (uint)seqidx + (uint)i < seq.length(); i++) {
-    if (query.at(i) == seq.at(seqidx + i)) {
-      lcp++;
-    } else {
-      if (query.at(i) < seq.at(seqidx + i)) {
-        // query string is before, return lcp -1
-        return lcp * -1 - 1;
-      } else {
-        // query string is after, return lcp + 1
-        return lcp + 1;
-      }
+template <std::size_t LEN>
+inline int lcpcompare(const std::string &seq, int seqidx,
+                      const std::string &query, int minlcp) {
+  std::size_t i = matchlength<LEN>(seq, seqidx, query, minlcp);
+  if (i < query.length() && seqidx + i < seq.length()) {
+    if (query[i] < seq[seqidx + i]) {
+      // query string is before, return lcp -1
+      return (int)i * -1 - 1;
     }
+    // query string is after, return lcp + 1
+    return (int)i + 1;
   }
-  // query string is equal
-  if (lcp == (int)query.length()) {
-    return 0;
-  } else {
-    // query string comes after
-    return 1;
-  }
+  // query string is equal, otherwise it runs past seq and comes after
+  return i == query.length() ? 0 : 1;
+}
+
+// sign only, like query.compare(seq.substr(seqidx, query.length()))
+template <std::size_t LEN>
+inline int querycompare(const std::string &seq, int seqidx,
+                        const std::string &query) {
+  return lcpcompare<LEN>(seq, seqidx, query, 0);
 }
 
+// lcp of query with the suffix of seq starting at seqidx
+template <std::size_t LEN>
+inline int querylcp(const std::string &seq, int seqidx,
+                    const std::string &query) {
+  return matchlength<LEN>(seq, seqidx, query, 0);
+}
+
+template <std::size_t LEN>
 void lcpsearch(int startidx, int endidx, std::string const &seq,
                sdsl::csa_wt<> &csa, std::string const &name,
                std::string const &query,
@@ -132,14 +195,14 @@ void lcpsearch(int startidx, int endidx, std::string const &seq,
   int smallest, largest;
   int start = startidx;
   int end = endidx;
-  int startlcp = lcp(query, seq.substr(csa[start], query.length()));
-  int endlcp = lcp(query, seq.substr(csa[end - 1], query.length()));
+  int startlcp = querylcp<LEN>(seq, csa[start], query);
+  int endlcp = querylcp<LEN>(seq, csa[end - 1], query);
   auto starttime = std::chrono::steady_clock::now();
   int minlcp;
   while (start <= end) {
     minlcp = std::min(startlcp, endlcp);
     int mid = (start + end) / 2;
-    int compare = lcpcompare(seq, csa[mid], query, minlcp);
+    int compare = lcpcompare<LEN>(seq, csa[mid], query, minlcp);
     // std::cout << start << "," << end << ", q: " << query << ", startlcp: " <<
     // startlcp << ", endlcp: " << endlcp << ", comapre: "<< compare  <<
     // std::endl;
@@ -156,7 +219,7 @@ void lcpsearch(int startidx, int endidx, std::string const &seq,
       // im too lazy to do a speedup here. Probably could help but \_(:/)_/
       // shouldn't be a majority of cases. Assuming that after
       found = true;
-      if (mid <= startidx || query.compare(seq.substr(csa[mid - 1], query.length())) > 0) {
+      if (mid <= startidx || querycompare<LEN>(seq, csa[mid - 1], query) > 0) {
         // we know we have the first one
         smallest = mid;
         break;
@@ -168,12 +231,12 @@ void lcpsearch(int startidx, int endidx, std::string const &seq,
   // do the same thing for largest index
   start = startidx;
   end = endidx;
-  startlcp = lcp(query, seq.substr(csa[start], query.length()));
-  endlcp = lcp(query, seq.substr(csa[end - 1], query.length()));
+  startlcp = querylcp<LEN>(seq, csa[start], query);
+  endlcp = querylcp<LEN>(seq, csa[end - 1], query);
   while (start <= end) {
     minlcp = std::min(startlcp, endlcp);
     int mid = (start + end) / 2;
-    int compare = lcpcompare(seq, csa[mid], query, minlcp);
+    int compare = lcpcompare<LEN>(seq, csa[mid], query, minlcp);
     // std::cout << start << ",  " << end << ", q: " << query << ", startlcp: "
     // << startlcp << ", endlcp: " << endlcp << ", comapre: " << compare  <<
     // std::endl;
@@ -187,7 +250,7 @@ void lcpsearch(int startidx, int endidx, std::string const &seq,
       startlcp = compare - 1;
     } else {
       if (mid >= endidx - 1 ||
-          query.compare(seq.substr(csa[mid + 1], query.length())) < 0) {
+          querycompare<LEN>(seq, csa[mid + 1], query) < 0) {
         // we know we have the last one
         largest = mid;
         break;
@@ -210,6 +273,7 @@ void lcpsearch(int startidx, int endidx, std::string const &seq,
   times[name] = duration;
 }
 
+template <std::size_t LEN>
 void binsearch(int startidx, int endidx, std::string const &seq,
                sdsl::csa_wt<> &csa, std::string const &name,
                std::string const &query,
@@ -222,10 +286,7 @@ void binsearch(int startidx, int endidx, std::string const &seq,
   auto starttime = std::chrono::steady_clock::now();
   while (start <= end) {
     int mid = (start + end) / 2;
-    std::string segment = seq.substr(csa[mid], query.length());
-    // std::cout << start << "," << end << ", q: " << query << ", segment: " <<
-    // segment << std::endl;
-    int compare = query.compare(segment);
+    int compare = querycompare<LEN>(seq, csa[mid], query);
     // query < mid
     if (compare < 0) {
       end = mid - 1;
@@ -235,8 +296,7 @@ void binsearch(int startidx, int endidx, std::string const &seq,
 
     } else {
       found = true;
-      if (mid == startidx ||
-          query.compare(seq.substr(csa[mid - 1], query.length())) > 0) {
+      if (mid == startidx || querycompare<LEN>(seq, csa[mid - 1], query) > 0) {
         // we know we have the first one
         smallest = mid;
         break;
@@ -249,10 +309,7 @@ void binsearch(int startidx, int endidx, std::string const &seq,
   end = endidx;
   while (start <= end) {
     int mid = (start + end) / 2;
-    std::string segment = seq.substr(csa[mid], query.length());
-    // std::cout << start << "," << end << ", q: " << query << ", segment: " <<
-    // segment << std::endl;
-    int compare = query.compare(segment);
+    int compare = querycompare<LEN>(seq, csa[mid], query);
     // query < mid
     if (compare < 0) {
       end = mid - 1;
@@ -262,7 +319,7 @@ void binsearch(int startidx, int endidx, std::string const &seq,
 
     } else {
       if (mid == endidx - 1 ||
-          query.compare(seq.substr(csa[mid + 1], query.length())) < 0) {
+          querycompare<LEN>(seq, csa[mid + 1], query) < 0) {
         // we know we have the last one
         largest = mid;
         break;
@@ -284,6 +341,7 @@ void binsearch(int startidx, int endidx, std::string const &seq,
   times[name] = duration;
 }
 
+template <std::size_t LEN>
 void naive(std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
            std::string &seq, sdsl::csa_wt<> &csa,
            std::unordered_map<std::string, std::string> &queries, int k,
@@ -294,10 +352,11 @@ void naive(std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
   int end = csa.size() - 1;
   for (const auto &[name, query] : queries) {
     // now do binary search!
-    binsearch(start, end, seq, csa, name, query, results, times);
+    binsearch<LEN>(start, end, seq, csa, name, query, results, times);
   }
 }
 
+template <std::size_t LEN>
 void naiveprefix(
     std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
     std::string &seq, sdsl::csa_wt<> &csa,
@@ -317,10 +376,11 @@ void naiveprefix(
     //}
 
     // now do binary search!
-    binsearch(start, end, seq, csa, name, query, results, times);
+    binsearch<LEN>(start, end, seq, csa, name, query, results, times);
   }
 }
 
+template <std::size_t LEN>
 void lcpnoprefix(
     std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
     std::string &seq, sdsl::csa_wt<> &csa,
@@ -331,9 +391,10 @@ void lcpnoprefix(
   int end = csa.size() - 1;
   for (const auto &[name, query] : queries) {
     // now do binary search!
-    lcpsearch(start, end, seq, csa, name, query, results, times);
+    lcpsearch<LEN>(start, end, seq, csa, name, query, results, times);
   }
 }
+template <std::size_t LEN>
 void lcpprefix(
     std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
     std::string &seq, sdsl::csa_wt<> &csa,
@@ -355,12 +416,49 @@ void lcpprefix(
     //}
     //std::cout << "start " << start << " end " << end << std::endl;
     // now do binary search!
-    lcpsearch(start, end, seq, csa, name, query, results, times);
+    lcpsearch<LEN>(start, end, seq, csa, name, query, results, times);
+  }
+}
+
+// runs the whole batch with the kernels for query length LEN
+template <std::size_t LEN>
+void runqueries(
+    bool accel,
+    std::unordered_map<std::string, std::pair<int, int>> &prefix_table,
+    std::string &seq, sdsl::csa_wt<> &csa,
+    std::unordered_map<std::string, std::string> &queries, int k,
+    std::unordered_map<std::string, std::pair<int, int>> &results,
+    std::unordered_map<std::string, double> &times) {
+  if (accel) {
+    if (k == -1) {
+      lcpnoprefix<LEN>(prefix_table, seq, csa, queries, k, results, times);
+    } else {
+      lcpprefix<LEN>(prefix_table, seq, csa, queries, k, results, times);
+    }
+  } else {
+    if (k == -1) {
+      naive<LEN>(prefix_table, seq, csa, queries, k, results, times);
+    } else {
+      naiveprefix<LEN>(prefix_table, seq, csa, queries, k, results, times);
+    }
+  }
+}
+
+// length shared by every query in the batch, or 0 if they differ
+std::size_t batchlength(
+    std::unordered_map<std::string, std::string> const &queries) {
+  std::size_t length = 0;
+  for (const auto &[name, query] : queries) {
+    if (length != 0 && query.length() != length) {
+      return 0;
+    }
+    length = query.length();
   }
+  return length;
 }
 
 int main(int argc, char **argv) {
-  struct arguments arguments;
+  struct arguments arguments = {};
 
   /* Parse our arguments; every option seen by parse_opt will
      be reflected in arguments. */
@@ -430,19 +528,37 @@ int main(int argc, char **argv) {
   std::unordered_map<std::string, std::pair<int, int>> results;
   std::unordered_map<std::string, double> times;
 
-  if (strcmp(arguments.query_mode, "simpaccel") == 0) {
-    if (k == -1) {
-      lcpnoprefix(prefix_table, seq, csa, queries, k, results, times);
-
-    } else {
-      lcpprefix(prefix_table, seq, csa, queries, k, results, times);
-    }
-  } else {
-    if (k == -1) {
-      naive(prefix_table, seq, csa, queries, k, results, times);
-    } else {
-      naiveprefix(prefix_table, seq, csa, queries, k, results, times);
+  // pick the kernels once for the whole batch. Fixed length kernels only
+  // exist for common read lengths, everything else takes the generic path.
+  std::size_t length = arguments.fixed ? batchlength(queries) : 0;
+  if (length != 32 && length != 64 && length != 100 && length != 150) {
+    if (arguments.fixed) {
+      std::cerr << "warning: -f needs queries of one length (32, 64, 100 or "
+                   "150), using the generic kernels"
+                << std::endl;
     }
+    length = 0;
+  }
+
+  bool accel = strcmp(arguments.query_mode, "simpaccel") == 0;
+  switch (length) {
+    case 32:
+      runqueries<32>(accel, prefix_table, seq, csa, queries, k, results, times);
+      break;
+    case 64:
+      runqueries<64>(accel, prefix_table, seq, csa, queries, k, results, times);
+      break;
+    case 100:
+      runqueries<100>(accel, prefix_table, seq, csa, queries, k, results,
+                      times);
+      break;
+    case 150:
+      runqueries<150>(accel, prefix_table, seq, csa, queries, k, results,
+                      times);
+      break;
+    default:
+      runqueries<0>(accel, prefix_table, seq, csa, queries, k, results, times);
+      break;
   }
 
   //std::cout << "serializing results" << std::endl;